@@ -1,6 +1,7 @@
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <queue>
 #include <limits>
 #include <algorithm>
@@ -137,6 +138,25 @@ public:
         }
     }
 
+    // Places within maxDist of start, nearest first. The search stops as soon
+    // as the next closest place is beyond the radius.
+    vector<pair<string, int>> withinRadius(const string& start, int maxDist) {
+        return boundedSearch(vector<string>{start}, maxDist, nullptr, 0);
+    }
+
+    // Multi-source isochrone: places within maxDist of any of the sources,
+    // computed as a single search seeded with every source at distance 0.
+    vector<pair<string, int>> withinRadius(const vector<string>& sources, int maxDist) {
+        return boundedSearch(sources, maxDist, nullptr, 0);
+    }
+
+    // The k places from targets closest to start. The search stops once the
+    // k-th target is settled.
+    vector<pair<string, int>> nearestK(const string& start, const vector<string>& targets, int k) {
+        unordered_set<string> targetSet(targets.begin(), targets.end());
+        return boundedSearch(vector<string>{start}, numeric_limits<int>::max(), &targetSet, k);
+    }
+
     void shortestPath(const string& start, const string& end) {
         unordered_map<string, int> distances;
         unordered_map<string, string> previous;
@@ -231,6 +251,50 @@ public:
 
 private:
     unordered_map<string, vector<Edge>> adjacencyList;
+
+    // Dijkstra that only touches the part of the graph it settles. Places are
+    // reported in the order they are settled, i.e. by increasing distance.
+    // If targets is given, only places in it are reported and the search ends
+    // after k of them; otherwise it ends when the next distance exceeds maxDist.
+    vector<pair<string, int>> boundedSearch(const vector<string>& sources, int maxDist,
+                                            const unordered_set<string>* targets, int k) {
+        vector<pair<string, int>> result;
+        if (targets != nullptr && k <= 0) return result;
+
+        unordered_map<string, int> distances;
+        priority_queue<pair<int, string>, vector<pair<int, string>>, greater<pair<int, string>>> pq;
+        for (const auto &source : sources) {
+            if (adjacencyList.find(source) != adjacencyList.end() && distances.find(source) == distances.end()) {
+                distances[source] = 0;
+                pq.push({0, source});
+            }
+        }
+
+        while (!pq.empty()) {
+            string current = pq.top().second;
+            int currentDistance = pq.top().first;
+            pq.pop();
+
+            if (currentDistance > distances[current]) continue;
+            if (currentDistance > maxDist) break;
+
+            if (targets == nullptr || targets->count(current)) {
+                result.push_back({current, currentDistance});
+                if (targets != nullptr && (int)result.size() == k) break;
+            }
+
+            for (const auto &edge : adjacencyList[current]) {
+                if (edge.weight > maxDist - currentDistance) continue;
+                int newDistance = currentDistance + edge.weight;
+                auto it = distances.find(edge.destination);
+                if (it == distances.end() || newDistance < it->second) {
+                    distances[edge.destination] = newDistance;
+                    pq.push({newDistance, edge.destination});
+                }
+            }
+        }
+        return result;
+    }
 };
 
 void displayMenu() {
@@ -247,6 +311,8 @@ void displayMenu() {
     cout << "10. Find Shortest Path between Two Places\n";
     cout << "11. Display All Roads\n";
     cout << "12. Check Connectivity\n";
+    cout << "13. Places Within Distance\n";
+    cout << "14. Nearest K Places From a Set\n";
     cout << "0. Exit\n";
 }
 
@@ -334,6 +400,38 @@ int main() {
             case 12:
                 g.isConnected();
                 break;
+            case 13: {
+                int count;
+                cout << "Enter number of starting places: ";
+                cin >> count;
+                vector<string> sources(max(count, 0));
+                cout << "Enter starting places and maximum distance: ";
+                for (auto &source : sources) cin >> source;
+                cin >> distance;
+                auto places = g.withinRadius(sources, distance);
+                cout << "Places within distance " << distance << ":\n";
+                for (const auto &place : places) {
+                    cout << place.first << ": " << place.second << endl;
+                }
+                break;
+            }
+            case 14: {
+                int count, k;
+                cout << "Enter starting place: ";
+                cin >> place1;
+                cout << "Enter number of candidate places: ";
+                cin >> count;
+                vector<string> targets(max(count, 0));
+                cout << "Enter candidate places and k: ";
+                for (auto &target : targets) cin >> target;
+                cin >> k;
+                auto places = g.nearestK(place1, targets, k);
+                cout << "Nearest places to " << place1 << ":\n";
+                for (const auto &place : places) {
+                    cout << place.first << ": " << place.second << endl;
+                }
+                break;
+            }
             case 0:
                 cout << "Exiting...\n";
                 break;
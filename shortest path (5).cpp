@@ -6,51 +6,668 @@
 #include <algorithm>
 #include <fstream>
 #include <stack>
+#include <deque>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <tuple>
+#include <filesystem>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_POSIX_IO 1
+#elif defined(_WIN32)
+#include <io.h>
+#endif
 
 using namespace std;
 
+// Fixed-size thread pool for graph queries. Each worker owns a task queue and
+// takes work from its back; an idle worker steals from the front of the others.
+class QueryPool {
+private:
+    struct WorkerQueue {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<WorkerQueue>> queues;
+    vector<thread> workers;
+    mutex sleepLock;
+    condition_variable wake;
+    atomic<size_t> pending{0};
+    atomic<size_t> nextQueue{0};
+    bool stopping = false;
+
+    bool tryPop(size_t self, function<void()> &task) {
+        {
+            lock_guard<mutex> guard(queues[self]->lock);
+            if (!queues[self]->tasks.empty()) {
+                task = move(queues[self]->tasks.back());
+                queues[self]->tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); ++i) {
+            auto &victim = *queues[(self + i) % queues.size()];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(size_t self) {
+        function<void()> task;
+        while (true) {
+            if (tryPop(self, task)) {
+                --pending;
+                task();
+                continue;
+            }
+            unique_lock<mutex> guard(sleepLock);
+            wake.wait(guard, [&] { return stopping || pending > 0; });
+            if (stopping && pending == 0) return;
+        }
+    }
+
+public:
+    explicit QueryPool(size_t threadCount = thread::hardware_concurrency()) {
+        if (threadCount == 0) threadCount = 1;
+        for (size_t i = 0; i < threadCount; ++i) {
+            queues.push_back(make_unique<WorkerQueue>());
+        }
+        for (size_t i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this, i] { run(i); });
+        }
+    }
+
+    // Queued tasks are still run before the workers exit.
+    ~QueryPool() {
+        {
+            lock_guard<mutex> guard(sleepLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    // pending is raised before the task is visible, so a worker that takes
+    // it straight away cannot decrement the count below zero.
+    void submit(function<void()> task) {
+        auto &queue = *queues[nextQueue++ % queues.size()];
+        {
+            lock_guard<mutex> guard(sleepLock);
+            ++pending;
+        }
+        {
+            lock_guard<mutex> guard(queue.lock);
+            queue.tasks.push_back(move(task));
+        }
+        wake.notify_one();
+    }
+
+    size_t size() const {
+        return workers.size();
+    }
+};
+
+// Distance oracle built by pruned landmark labeling. Every city gets a label
+// of (hub, distance) pairs sorted by hub, and the distance between two cities
+// is the smallest d1 + d2 over the hubs their labels share. Labels are built
+// once with build() and answered from a file mapped into memory by load().
+//
+// File layout: "HUBL", city count n, entry count m, then n + 1 label offsets
+// (uint64), m hub ranks (uint32), m distances (int32), and the city names as
+// a 32-bit length followed by the bytes.
+class HubLabels {
+private:
+    const char *data = nullptr;
+    size_t dataSize = 0;
+    bool mapped = false;
+    vector<char> buffer;
+
+    uint32_t cityCount = 0;
+    uint64_t entryCount = 0;
+    const uint64_t *offsets = nullptr;
+    const uint32_t *hubs = nullptr;
+    const int32_t *hubDistances = nullptr;
+    unordered_map<string, uint32_t> cityIds;
+
+    static const uint32_t HeaderSize = 16;
+
+    void release() {
+#ifdef HAVE_POSIX_IO
+        if (mapped) munmap(const_cast<char *>(data), dataSize);
+#endif
+        data = nullptr;
+        dataSize = 0;
+        mapped = false;
+        buffer.clear();
+        cityIds.clear();
+        cityCount = 0;
+        entryCount = 0;
+    }
+
+    // Shortest distance among the labels already built, or INT_MAX.
+    static long long labelDistance(const vector<pair<uint32_t, int>> &a, const vector<pair<uint32_t, int>> &b) {
+        long long best = numeric_limits<int>::max();
+        size_t i = 0, j = 0;
+        while (i < a.size() && j < b.size()) {
+            if (a[i].first < b[j].first) {
+                ++i;
+            } else if (a[i].first > b[j].first) {
+                ++j;
+            } else {
+                best = min(best, (long long)a[i].second + b[j].second);
+                ++i;
+                ++j;
+            }
+        }
+        return best;
+    }
+
+public:
+    HubLabels() = default;
+    HubLabels(const HubLabels &) = delete;
+    HubLabels &operator=(const HubLabels &) = delete;
+
+    ~HubLabels() {
+        release();
+    }
+
+    // Builds labels for adj (connections stored in both directions) and
+    // writes them to filename. Cities are processed in order of decreasing
+    // degree, which keeps labels short on road networks. The file is written
+    // beside filename and renamed into place, so a HubLabels that has the
+    // old file mapped keeps reading the old labels.
+    static bool build(const unordered_map<string, vector<pair<string, int>>> &adj, const string &filename) {
+        vector<string> names;
+        for (const auto &pair : adj) {
+            names.push_back(pair.first);
+        }
+        sort(names.begin(), names.end(), [&](const string &a, const string &b) {
+            size_t degreeA = adj.at(a).size(), degreeB = adj.at(b).size();
+            return degreeA != degreeB ? degreeA > degreeB : a < b;
+        });
+        uint32_t n = static_cast<uint32_t>(names.size());
+        unordered_map<string, uint32_t> rank;
+        for (uint32_t i = 0; i < n; ++i) {
+            rank[names[i]] = i;
+        }
+        vector<vector<pair<uint32_t, int>>> edges(n);
+        for (uint32_t i = 0; i < n; ++i) {
+            for (const auto &neighbor : adj.at(names[i])) {
+                auto it = rank.find(neighbor.first);
+                if (it != rank.end()) edges[i].push_back({it->second, neighbor.second});
+            }
+        }
+
+        // One pruned Dijkstra per city, in rank order. A city already covered
+        // by earlier hubs at no greater distance is neither labelled nor
+        // expanded. Hubs are added in rank order, so labels stay sorted.
+        vector<vector<pair<uint32_t, int>>> labels(n);
+        vector<int> distances(n, numeric_limits<int>::max());
+        vector<uint32_t> touched;
+        for (uint32_t hub = 0; hub < n; ++hub) {
+            priority_queue<pair<int, uint32_t>, vector<pair<int, uint32_t>>, greater<>> pq;
+            distances[hub] = 0;
+            touched.push_back(hub);
+            pq.push({0, hub});
+
+            while (!pq.empty()) {
+                auto [currentDist, current] = pq.top();
+                pq.pop();
+
+                if (currentDist > distances[current]) continue;
+                if (labelDistance(labels[hub], labels[current]) <= currentDist) continue;
+                labels[current].push_back({hub, currentDist});
+
+                for (const auto &[neighbor, weight] : edges[current]) {
+                    long long newDist = (long long)currentDist + weight;
+                    if (newDist < distances[neighbor]) {
+                        if (distances[neighbor] == numeric_limits<int>::max()) touched.push_back(neighbor);
+                        distances[neighbor] = static_cast<int>(newDist);
+                        pq.push({distances[neighbor], neighbor});
+                    }
+                }
+            }
+
+            for (uint32_t city : touched) {
+                distances[city] = numeric_limits<int>::max();
+            }
+            touched.clear();
+        }
+
+        string tempPath = filename + ".tmp";
+        ofstream file(tempPath, ios::binary | ios::trunc);
+        auto writeRaw = [&](const void *value, size_t size) {
+            file.write(static_cast<const char *>(value), size);
+        };
+        uint64_t m = 0;
+        vector<uint64_t> labelOffsets = {0};
+        for (const auto &label : labels) {
+            m += label.size();
+            labelOffsets.push_back(m);
+        }
+        writeRaw("HUBL", 4);
+        writeRaw(&n, sizeof(n));
+        writeRaw(&m, sizeof(m));
+        writeRaw(labelOffsets.data(), labelOffsets.size() * sizeof(uint64_t));
+        for (const auto &label : labels) {
+            for (const auto &entry : label) writeRaw(&entry.first, sizeof(uint32_t));
+        }
+        for (const auto &label : labels) {
+            for (const auto &entry : label) writeRaw(&entry.second, sizeof(int32_t));
+        }
+        for (const auto &name : names) {
+            uint32_t length = static_cast<uint32_t>(name.size());
+            writeRaw(&length, sizeof(length));
+            writeRaw(name.data(), name.size());
+        }
+        file.close();
+        if (!file) return false;
+        error_code error;
+        filesystem::rename(tempPath, filename, error);
+        return !error;
+    }
+
+    bool load(const string &filename) {
+        release();
+#ifdef HAVE_POSIX_IO
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void *region = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (region != MAP_FAILED) {
+                data = static_cast<const char *>(region);
+                dataSize = info.st_size;
+                mapped = true;
+            }
+        }
+        close(fd);
+#endif
+        if (!mapped) {
+            ifstream file(filename, ios::binary);
+            if (!file) return false;
+            buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+            data = buffer.data();
+            dataSize = buffer.size();
+        }
+
+        if (dataSize < HeaderSize || memcmp(data, "HUBL", 4) != 0) {
+            release();
+            return false;
+        }
+        memcpy(&cityCount, data + 4, sizeof(cityCount));
+        memcpy(&entryCount, data + 8, sizeof(entryCount));
+        size_t available = dataSize - HeaderSize;
+        if ((uint64_t(cityCount) + 1) * sizeof(uint64_t) > available) {
+            release();
+            return false;
+        }
+        size_t hubsStart = HeaderSize + (size_t(cityCount) + 1) * sizeof(uint64_t);
+        if (entryCount > (dataSize - hubsStart) / (sizeof(uint32_t) + sizeof(int32_t))) {
+            release();
+            return false;
+        }
+        size_t namesStart = hubsStart + entryCount * (sizeof(uint32_t) + sizeof(int32_t));
+        offsets = reinterpret_cast<const uint64_t *>(data + HeaderSize);
+
+        // Labels must tile the entry arrays exactly, or lookups would read
+        // outside them.
+        bool offsetsValid = offsets[0] == 0 && offsets[cityCount] == entryCount;
+        for (uint32_t i = 0; offsetsValid && i < cityCount; ++i) {
+            offsetsValid = offsets[i] <= offsets[i + 1];
+        }
+        if (!offsetsValid) {
+            release();
+            return false;
+        }
+        hubs = reinterpret_cast<const uint32_t *>(data + hubsStart);
+        hubDistances = reinterpret_cast<const int32_t *>(data + hubsStart + entryCount * sizeof(uint32_t));
+
+        size_t at = namesStart;
+        for (uint32_t i = 0; i < cityCount; ++i) {
+            uint32_t length;
+            if (at + sizeof(length) > dataSize) break;
+            memcpy(&length, data + at, sizeof(length));
+            at += sizeof(length);
+            if (at + length > dataSize) break;
+            cityIds[string(data + at, length)] = i;
+            at += length;
+        }
+        if (cityIds.size() != cityCount) {
+            release();
+            return false;
+        }
+        return true;
+    }
+
+    bool loaded() const {
+        return data != nullptr;
+    }
+
+    // Shortest distance between two cities, or INT_MAX if either is unknown
+    // or they are not connected.
+    int distance(const string &city1, const string &city2) const {
+        auto a = cityIds.find(city1), b = cityIds.find(city2);
+        if (a == cityIds.end() || b == cityIds.end()) return numeric_limits<int>::max();
+
+        uint64_t i = offsets[a->second], iEnd = offsets[a->second + 1];
+        uint64_t j = offsets[b->second], jEnd = offsets[b->second + 1];
+        long long best = numeric_limits<int>::max();
+        while (i < iEnd && j < jEnd) {
+            if (hubs[i] < hubs[j]) {
+                ++i;
+            } else if (hubs[i] > hubs[j]) {
+                ++j;
+            } else {
+                best = min(best, (long long)hubDistances[i] + hubDistances[j]);
+                ++i;
+                ++j;
+            }
+        }
+        // Two label distances can add up past INT_MAX; report that as no path.
+        return static_cast<int>(min(best, (long long)numeric_limits<int>::max()));
+    }
+
+    void printStatistics() const {
+        uint64_t largest = 0;
+        for (uint32_t i = 0; i < cityCount; ++i) {
+            largest = max(largest, offsets[i + 1] - offsets[i]);
+        }
+        cout << "Labels: " << cityCount << " cities, " << entryCount << " entries, "
+             << (cityCount ? double(entryCount) / cityCount : 0.0) << " average, "
+             << largest << " largest, " << dataSize << " bytes" << endl;
+    }
+};
+
 class CityGraph {
 private:
     unordered_map<string, vector<pair<string, int>>> adjList;
+    // Held shared by asynchronous queries and exclusively by the mutators.
+    mutable shared_mutex adjLock;
+
+    // LogEpoch opens a snapshot and carries its number in the distance field.
+    // LogCity records a city that has no connections.
+    enum LogOp : char { LogAdd = 1, LogRemove = 2, LogUpdate = 3, LogClear = 4, LogEpoch = 5, LogCity = 6 };
+
+    // Write-ahead log state, all guarded by logMutex. Records are numbered as
+    // they are appended to logBuffer; logCommitted is the last number synced
+    // to disk. While logFlushing is set, one thread is writing a batch
+    // without holding logMutex, and nobody else may touch logFile. Once a
+    // write fails, or the log cannot be opened, logFailed is set and no
+    // later record is acknowledged until logging is enabled again; the
+    // records lost meanwhile are logLostFrom..logLostTo.
+    FILE *logFile = nullptr;
+    string logPath;
+    string logBuffer;
+    uint64_t logAppended = 0;
+    uint64_t logCommitted = 0;
+    uint64_t logLostFrom = 1;
+    uint64_t logLostTo = 0;
+    bool logFlushing = false;
+    bool logFailed = false;
+    mutex logMutex;
+    condition_variable logFlushed;
+
+    // Snapshot state, guarded by snapshotMutex. Lock order is snapshotMutex,
+    // then adjLock, then logMutex.
+    uint32_t snapshotEpoch = 0;
+    thread snapshotWriter;
+    mutex snapshotMutex;
+
+    // Scratch space for one shortest-path search, reused between the queries
+    // run on the same worker thread.
+    struct SearchWorkspace {
+        unordered_map<string, int> distances;
+        unordered_map<string, string> previous;
+        vector<pair<int, string>> heap;
+    };
 
 public:
+    struct RouteResult {
+        enum Status { Found, NoPath, Cancelled, TimedOut };
+        Status status = NoPath;
+        vector<string> path;
+        int distance = numeric_limits<int>::max();
+    };
+
+    using Deadline = chrono::steady_clock::time_point;
+
+    CityGraph() = default;
+
+    ~CityGraph() {
+        {
+            lock_guard<mutex> guard(snapshotMutex);
+            if (snapshotWriter.joinable()) snapshotWriter.join();
+        }
+        commitLog();
+        lock_guard<mutex> guard(logMutex);
+        if (logFile != nullptr) fclose(logFile);
+    }
+
     void addConnection(const string &city1, const string &city2, int distance) {
-        adjList[city1].push_back({city2, distance});
-        adjList[city2].push_back({city1, distance}); // Bidirectional connection
+        uint64_t record;
+        {
+            unique_lock<shared_mutex> guard(adjLock);
+            applyAdd(city1, city2, distance);
+            record = logMutation(LogAdd, city1, city2, distance);
+        }
+        commitOrWarn(record, city1, city2);
     }
 
     void removeConnection(const string &city1, const string &city2) {
-        auto &neighbors1 = adjList[city1];
-        auto &neighbors2 = adjList[city2];
+        uint64_t record;
+        {
+            unique_lock<shared_mutex> guard(adjLock);
+            applyRemove(city1, city2);
+            record = logMutation(LogRemove, city1, city2, 0);
+        }
+        commitOrWarn(record, city1, city2);
+        cout << "Connection removed between " << city1 << " and " << city2 << endl;
+    }
 
-        neighbors1.erase(remove_if(neighbors1.begin(), neighbors1.end(),
-                                   [&](const pair<string, int> &p) { return p.first == city2; }),
-                         neighbors1.end());
+    void updateConnection(const string &city1, const string &city2, int newDistance) {
+        uint64_t record;
+        {
+            unique_lock<shared_mutex> guard(adjLock);
+            applyUpdate(city1, city2, newDistance);
+            record = logMutation(LogUpdate, city1, city2, newDistance);
+        }
+        commitOrWarn(record, city1, city2);
+        cout << "Connection updated between " << city1 << " and " << city2 << " to " << newDistance << " km." << endl;
+    }
 
-        neighbors2.erase(remove_if(neighbors2.begin(), neighbors2.end(),
-                                   [&](const pair<string, int> &p) { return p.first == city1; }),
-                         neighbors2.end());
+    // Appends every later mutation to a binary write-ahead log at path. A
+    // mutator returns only after its record has been written and synced to
+    // disk; mutators that arrive while a sync is in progress are committed
+    // together in the next one. Call recover() first to restart from an
+    // existing log.
+    bool enableMutationLog(const string &path) {
+        bool opened;
+        {
+            lock_guard<mutex> snapshotGuard(snapshotMutex);
+            unique_lock<shared_mutex> guard(adjLock);
+            opened = openLogLocked(path);
+        }
+        if (opened) {
+            cout << "Logging changes to " << path << endl;
+        } else {
+            cout << "Could not open log " << path << "; changes are not being logged" << endl;
+        }
+        return opened;
+    }
 
-        cout << "Connection removed between " << city1 << " and " << city2 << endl;
+    // Returns false if some record could not be written.
+    bool commitLog() {
+        uint64_t record;
+        {
+            lock_guard<mutex> guard(logMutex);
+            record = logAppended;
+        }
+        return waitForCommit(record);
     }
 
-    void updateConnection(const string &city1, const string &city2, int newDistance) {
-        for (auto &neighbor : adjList[city1]) {
-            if (neighbor.first == city2) {
-                neighbor.second = newDistance;
-                break;
+    // Writes the current graph to snapshotPath on a background thread. The
+    // live log is first renamed to "<log>.<n>", where n is the snapshot's
+    // number, so every record is in exactly one file. Segments are deleted
+    // once the snapshot that covers them is in place; until then recovery
+    // replays them on top of the previous snapshot. Queries keep running
+    // while the graph is copied; only mutators wait.
+    void takeSnapshot(const string &snapshotPath) {
+        lock_guard<mutex> snapshotGuard(snapshotMutex);
+        if (snapshotWriter.joinable()) snapshotWriter.join();
+
+        auto copy = make_shared<unordered_map<string, vector<pair<string, int>>>>();
+        string segmentsOf;
+        uint32_t epoch;
+        {
+            shared_lock<shared_mutex> guard(adjLock);
+            unique_lock<mutex> logGuard(logMutex);
+            // Never reuse a number already on disk, even if this process did
+            // not recover from it.
+            epoch = max(snapshotEpoch, snapshotFileEpoch(snapshotPath));
+            if (logFile != nullptr) {
+                for (const auto &segment : logSegments(logPath)) {
+                    epoch = max(epoch, segment.first);
+                }
+            }
+            snapshotEpoch = ++epoch;
+            *copy = adjList;
+
+            if (logFile != nullptr) {
+                if (!drainLogLocked(logGuard)) {
+                    cout << "Snapshot to " << snapshotPath << " cancelled: the log could not be written" << endl;
+                    return;
+                }
+                fclose(logFile);
+                logFile = nullptr;
+                error_code error;
+                filesystem::rename(logPath, logPath + "." + to_string(epoch), error);
+                logFile = fopen(logPath.c_str(), "ab");
+                if (error) {
+                    logFailed = logFile == nullptr;
+                    cout << "Snapshot to " << snapshotPath << " cancelled: could not rotate " << logPath << endl;
+                    return;
+                }
+                if (logFile == nullptr) {
+                    logFailed = true;
+                    cout << "Could not reopen log " << logPath << "; changes are not being logged" << endl;
+                }
+                syncDirectory(logPath);
+                segmentsOf = logPath;
             }
         }
-        for (auto &neighbor : adjList[city2]) {
-            if (neighbor.first == city1) {
-                neighbor.second = newDistance;
-                break;
+
+        snapshotWriter = thread([copy, snapshotPath, segmentsOf, epoch] {
+            string tempPath = snapshotPath + ".tmp";
+            FILE *out = fopen(tempPath.c_str(), "wb");
+            bool written = out != nullptr && writeRecord(out, LogEpoch, "", "", static_cast<int>(epoch));
+            for (auto pair = copy->begin(); written && pair != copy->end(); ++pair) {
+                if (pair->second.empty()) {
+                    written = writeRecord(out, LogCity, pair->first, "", 0);
+                }
+                size_t selfLoops = 0;
+                for (const auto &neighbor : pair->second) {
+                    // Each connection is stored in both directions, and both
+                    // copies of a self-loop in the same list; write it once.
+                    if (pair->first < neighbor.first || (pair->first == neighbor.first && (selfLoops++ & 1))) {
+                        written = written && writeRecord(out, LogAdd, pair->first, neighbor.first, neighbor.second);
+                    }
+                }
+            }
+            if (out != nullptr) {
+                written = syncFile(out) && written;
+                written = fclose(out) == 0 && written;
+            }
+            error_code error;
+            if (written) filesystem::rename(tempPath, snapshotPath, error);
+            if (!written || error) {
+                remove(tempPath.c_str());
+                cout << "Snapshot to " << snapshotPath << " failed" << endl;
+                return;
+            }
+            syncDirectory(snapshotPath);
+            if (!segmentsOf.empty()) {
+                for (const auto &segment : logSegments(segmentsOf)) {
+                    if (segment.first <= epoch) remove(segment.second.c_str());
+                }
+            }
+        });
+        cout << "Snapshot of graph started to " << snapshotPath << endl;
+    }
+
+    // Rebuilds the graph from the latest snapshot and the log written since,
+    // then keeps logging to path. Segments the snapshot already covers are
+    // deleted instead of replayed. A torn record at the end of a log is
+    // ignored and cut off, so new records are not appended after it.
+    void recover(const string &snapshotPath, const string &path) {
+        lock_guard<mutex> snapshotGuard(snapshotMutex);
+        if (snapshotWriter.joinable()) snapshotWriter.join();
+        size_t replayed = 0;
+        bool opened;
+        {
+            unique_lock<shared_mutex> guard(adjLock);
+            adjList.clear();
+            uint32_t covered = 0;
+            streamoff validBytes;
+            replayFile(snapshotPath, covered, validBytes);
+            uint32_t latest = covered;
+
+            vector<string> logs;
+            for (const auto &segment : logSegments(path)) {
+                latest = max(latest, segment.first);
+                if (segment.first <= covered) {
+                    remove(segment.second.c_str());
+                } else {
+                    logs.push_back(segment.second);
+                }
+            }
+            logs.push_back(path);
+
+            for (const string &log : logs) {
+                uint32_t unused = 0;
+                replayed += replayFile(log, unused, validBytes);
+                error_code error;
+                uintmax_t size = filesystem::file_size(log, error);
+                if (!error && size > static_cast<uintmax_t>(validBytes)) {
+                    filesystem::resize_file(log, validBytes, error);
+                }
             }
+            snapshotEpoch = latest;
+            opened = openLogLocked(path);
+        }
+        cout << "Graph recovered from " << snapshotPath << " with " << replayed << " logged changes" << endl;
+        if (opened) {
+            cout << "Logging changes to " << path << endl;
+        } else {
+            cout << "Could not open log " << path << "; changes are not being logged" << endl;
         }
-        cout << "Connection updated between " << city1 << " and " << city2 << " to " << newDistance << " km." << endl;
     }
 
     void printConnections() {
+        shared_lock<shared_mutex> guard(adjLock);
         for (const auto &pair : adjList) {
             cout << pair.first << " -> ";
             for (const auto &neighbor : pair.second) {
@@ -64,6 +681,7 @@ public:
         unordered_map<string, int> distances;
         unordered_map<string, string> previous;
         priority_queue<pair<int, string>, vector<pair<int, string>>, greater<>> pq;
+        shared_lock<shared_mutex> guard(adjLock);
 
         for (const auto &pair : adjList) {
             distances[pair.first] = numeric_limits<int>::max();
@@ -77,7 +695,7 @@ public:
 
             if (currentCity == destination) break;
 
-            for (const auto &[neighbor, weight] : adjList[currentCity]) {
+            for (const auto &[neighbor, weight] : neighborsOf(currentCity)) {
                 int newDist = currentDist + weight;
                 if (newDist < distances[neighbor]) {
                     distances[neighbor] = newDist;
@@ -105,30 +723,63 @@ public:
         cout << "\nDistance: " << distances[destination] << " km" << endl;
     }
 
-    void findAllPaths(const string &start, const string &end, vector<string>& path, vector<vector<string>>& allPaths) {
-        path.push_back(start);
+    // Same search as findShortestPath, but returns the route instead of
+    // printing it. The search gives up early if *cancel becomes true or the
+    // deadline passes.
+    RouteResult computeShortestPath(const string &start, const string &destination,
+                                    const atomic<bool> *cancel = nullptr,
+                                    Deadline deadline = Deadline::max()) const {
+        static thread_local SearchWorkspace workspace;
+        RouteResult result;
+        if (stopRequested(cancel, deadline, result)) return result;
+        shared_lock<shared_mutex> guard(adjLock);
+        return runShortestPath(workspace, start, destination, cancel, deadline);
+    }
 
-        if (start == end) {
-            allPaths.push_back(path);
+    // Queues a shortest-path query on the pool. The graph must outlive the
+    // pool's pending queries.
+    future<RouteResult> submitShortestPath(QueryPool &pool, const string &start, const string &destination,
+                                           shared_ptr<atomic<bool>> cancel = nullptr,
+                                           Deadline deadline = Deadline::max()) const {
+        auto task = make_shared<packaged_task<RouteResult()>>([=] {
+            return computeShortestPath(start, destination, cancel.get(), deadline);
+        });
+        future<RouteResult> result = task->get_future();
+        pool.submit([task] { (*task)(); });
+        return result;
+    }
+
+    // Builds a hub-label distance oracle for the current graph and writes it
+    // to filename; load it with HubLabels::load().
+    void buildHubLabels(const string &filename) const {
+        unordered_map<string, vector<pair<string, int>>> copy;
+        {
+            shared_lock<shared_mutex> guard(adjLock);
+            copy = adjList;
+        }
+        bool written = HubLabels::build(copy, filename);
+        if (written) {
+            cout << "Distance labels saved to " << filename << endl;
         } else {
-            for (const auto &neighbor : adjList[start]) {
-                if (find(path.begin(), path.end(), neighbor.first) == path.end()) {
-                    findAllPaths(neighbor.first, end, path, allPaths);
-                }
-            }
+            cout << "Could not write distance labels to " << filename << endl;
         }
-        path.pop_back();
+    }
+
+    void findAllPaths(const string &start, const string &end, vector<string>& path, vector<vector<string>>& allPaths) {
+        shared_lock<shared_mutex> guard(adjLock);
+        findAllPathsUtil(start, end, path, allPaths);
     }
 
     void findLongestPath(const string &start, const string &end, vector<string>& path, vector<vector<string>>& allPaths) {
-        findAllPaths(start, end, path, allPaths);
+        shared_lock<shared_mutex> guard(adjLock);
+        findAllPathsUtil(start, end, path, allPaths);
         int longest = 0;
         vector<string> longestPath;
 
         for (const auto &p : allPaths) {
             int length = 0;
             for (size_t i = 0; i < p.size() - 1; ++i) {
-                for (const auto &neighbor : adjList[p[i]]) {
+                for (const auto &neighbor : neighborsOf(p[i])) {
                     if (neighbor.first == p[i + 1]) {
                         length += neighbor.second;
                     }
@@ -148,19 +799,21 @@ public:
     }
 
     void displayCityNeighbors(const string &city) {
+        shared_lock<shared_mutex> guard(adjLock);
         if (adjList.find(city) == adjList.end()) {
             cout << "City not found!" << endl;
             return;
         }
 
         cout << "Neighbors of " << city << ": ";
-        for (const auto &neighbor : adjList[city]) {
+        for (const auto &neighbor : neighborsOf(city)) {
             cout << neighbor.first << " ";
         }
         cout << endl;
     }
 
     void findIsolatedCities() {
+        shared_lock<shared_mutex> guard(adjLock);
         cout << "Isolated cities (no connections): ";
         bool found = false;
         for (const auto &pair : adjList) {
@@ -178,6 +831,7 @@ public:
 
     void saveGraphToFile(const string &filename) {
         ofstream file(filename);
+        shared_lock<shared_mutex> guard(adjLock);
         for (const auto &pair : adjList) {
             for (const auto &neighbor : pair.second) {
                 file << pair.first << " " << neighbor.first << " " << neighbor.second << "\n";
@@ -191,15 +845,31 @@ public:
         ifstream file(filename);
         string city1, city2;
         int distance;
-        adjList.clear();
+        vector<tuple<string, string, int>> connections;
         while (file >> city1 >> city2 >> distance) {
-            addConnection(city1, city2, distance);
+            connections.emplace_back(city1, city2, distance);
         }
         file.close();
+
+        // Swap in the whole file at once so queries never see it half loaded.
+        uint64_t record;
+        {
+            unique_lock<shared_mutex> guard(adjLock);
+            adjList.clear();
+            record = logMutation(LogClear, "", "", 0);
+            for (const auto &[from, to, length] : connections) {
+                applyAdd(from, to, length);
+                record = logMutation(LogAdd, from, to, length);
+            }
+        }
+        if (!waitForCommit(record)) {
+            cout << "Warning: the loaded graph could not be written to the log" << endl;
+        }
         cout << "Graph loaded from " << filename << endl;
     }
 
     void bfs(const string &start) {
+        shared_lock<shared_mutex> guard(adjLock);
         unordered_map<string, bool> visited;
         queue<string> q;
         q.push(start);
@@ -211,7 +881,7 @@ public:
             q.pop();
             cout << city << " ";
 
-            for (const auto &neighbor : adjList[city]) {
+            for (const auto &neighbor : neighborsOf(city)) {
                 if (!visited[neighbor.first]) {
                     visited[neighbor.first] = true;
                     q.push(neighbor.first);
@@ -221,11 +891,12 @@ public:
         cout << endl;
     }
 
+    // Caller holds adjLock.
     void dfsUtil(const string &city, unordered_map<string, bool> &visited) {
         visited[city] = true;
         cout << city << " ";
 
-        for (const auto &neighbor : adjList[city]) {
+        for (const auto &neighbor : neighborsOf(city)) {
             if (!visited[neighbor.first]) {
                 dfsUtil(neighbor.first, visited);
             }
@@ -233,15 +904,352 @@ public:
     }
 
     void dfs(const string &start) {
+        shared_lock<shared_mutex> guard(adjLock);
         unordered_map<string, bool> visited;
         cout << "DFS Traversal starting from " << start << ": ";
         dfsUtil(start, visited);
         cout << endl;
     }
+
+private:
+    // Looks a city up without inserting it, so readers can share adjLock.
+    const vector<pair<string, int>> &neighborsOf(const string &city) const {
+        static const vector<pair<string, int>> none;
+        auto it = adjList.find(city);
+        return it == adjList.end() ? none : it->second;
+    }
+
+    // Caller holds adjLock.
+    void findAllPathsUtil(const string &start, const string &end, vector<string>& path, vector<vector<string>>& allPaths) {
+        path.push_back(start);
+
+        if (start == end) {
+            allPaths.push_back(path);
+        } else {
+            for (const auto &neighbor : neighborsOf(start)) {
+                if (find(path.begin(), path.end(), neighbor.first) == path.end()) {
+                    findAllPathsUtil(neighbor.first, end, path, allPaths);
+                }
+            }
+        }
+        path.pop_back();
+    }
+
+    void applyAdd(const string &city1, const string &city2, int distance) {
+        adjList[city1].push_back({city2, distance});
+        adjList[city2].push_back({city1, distance}); // Bidirectional connection
+    }
+
+    void applyRemove(const string &city1, const string &city2) {
+        auto &neighbors1 = adjList[city1];
+        auto &neighbors2 = adjList[city2];
+
+        neighbors1.erase(remove_if(neighbors1.begin(), neighbors1.end(),
+                                   [&](const pair<string, int> &p) { return p.first == city2; }),
+                         neighbors1.end());
+
+        neighbors2.erase(remove_if(neighbors2.begin(), neighbors2.end(),
+                                   [&](const pair<string, int> &p) { return p.first == city1; }),
+                         neighbors2.end());
+    }
+
+    void applyUpdate(const string &city1, const string &city2, int newDistance) {
+        for (auto &neighbor : adjList[city1]) {
+            if (neighbor.first == city2) {
+                neighbor.second = newDistance;
+                break;
+            }
+        }
+        // A self-loop keeps both of its copies in the same list; skip the one
+        // just updated so the two stay equal.
+        bool skipFirst = city1 == city2;
+        for (auto &neighbor : adjList[city2]) {
+            if (neighbor.first == city1) {
+                if (skipFirst) {
+                    skipFirst = false;
+                    continue;
+                }
+                neighbor.second = newDistance;
+                break;
+            }
+        }
+    }
+
+    // Record layout: op byte, then each city as a 32-bit length and its bytes,
+    // then the distance as a 32-bit integer.
+    static void appendRecord(string &buffer, LogOp op, const string &city1, const string &city2, int distance) {
+        auto appendInt = [&](uint32_t value) {
+            buffer.append(reinterpret_cast<const char *>(&value), sizeof(value));
+        };
+        buffer.push_back(op);
+        appendInt(static_cast<uint32_t>(city1.size()));
+        buffer += city1;
+        appendInt(static_cast<uint32_t>(city2.size()));
+        buffer += city2;
+        appendInt(static_cast<uint32_t>(distance));
+    }
+
+    static bool writeRecord(FILE *out, LogOp op, const string &city1, const string &city2, int distance) {
+        string record;
+        appendRecord(record, op, city1, city2, distance);
+        return fwrite(record.data(), 1, record.size(), out) == record.size();
+    }
+
+    static bool readRecord(ifstream &in, char &op, string &city1, string &city2, int &distance) {
+        auto readInt = [&](uint32_t &value) {
+            return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof(value)));
+        };
+        auto readString = [&](string &value) {
+            uint32_t length;
+            if (!readInt(length)) return false;
+            value.resize(length);
+            return static_cast<bool>(in.read(&value[0], length));
+        };
+        uint32_t rawDistance;
+        if (!in.get(op) || !readString(city1) || !readString(city2) || !readInt(rawDistance)) return false;
+        distance = static_cast<int>(rawDistance);
+        return true;
+    }
+
+    // Flushes file and forces it to disk.
+    static bool syncFile(FILE *file) {
+        if (fflush(file) != 0) return false;
+#if defined(HAVE_POSIX_IO)
+        return fsync(fileno(file)) == 0;
+#elif defined(_WIN32)
+        return _commit(_fileno(file)) == 0;
+#else
+        return true;
+#endif
+    }
+
+    // Makes a rename or newly created file in path's directory durable.
+    static void syncDirectory(const string &path) {
+#ifdef HAVE_POSIX_IO
+        string directory = filesystem::path(path).parent_path().string();
+        int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+#else
+        (void)path;
+#endif
+    }
+
+    // Rotated log segments "<path>.<n>", in increasing order of n.
+    static vector<pair<uint32_t, string>> logSegments(const string &path) {
+        vector<pair<uint32_t, string>> segments;
+        filesystem::path log(path);
+        filesystem::path directory = log.parent_path().empty() ? filesystem::path(".") : log.parent_path();
+        string prefix = log.filename().string() + ".";
+        error_code error;
+        for (filesystem::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+            string name = it->path().filename().string();
+            if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0) continue;
+            string number = name.substr(prefix.size());
+            if (number.size() > 9 || !all_of(number.begin(), number.end(), ::isdigit)) continue;
+            segments.push_back({static_cast<uint32_t>(stoul(number)), (directory / name).string()});
+        }
+        sort(segments.begin(), segments.end());
+        return segments;
+    }
+
+    // Number of the snapshot at path, or 0 if there is none.
+    static uint32_t snapshotFileEpoch(const string &path) {
+        ifstream in(path, ios::binary);
+        char op;
+        string city1, city2;
+        int distance;
+        if (readRecord(in, op, city1, city2, distance) && op == LogEpoch) {
+            return static_cast<uint32_t>(distance);
+        }
+        return 0;
+    }
+
+    // Caller holds adjLock exclusively. Queues the record and returns its
+    // number for waitForCommit(), or 0 if logging is off.
+    uint64_t logMutation(LogOp op, const string &city1, const string &city2, int distance) {
+        lock_guard<mutex> guard(logMutex);
+        if (logFile == nullptr && !logFailed) return 0;
+        if (!logFailed) appendRecord(logBuffer, op, city1, city2, distance);
+        return ++logAppended;
+    }
+
+    // Returns true once the given record is synced to the log, or false if
+    // it never will be. The first waiter writes and syncs everything queued
+    // so far; the others wait for it and are done if their record was in
+    // that batch.
+    bool waitForCommit(uint64_t record) {
+        unique_lock<mutex> guard(logMutex);
+        while (logCommitted < record) {
+            if (logFailed) return false;
+            if (logFlushing) {
+                logFlushed.wait(guard);
+                continue;
+            }
+            logFlushing = true;
+            string batch;
+            batch.swap(logBuffer);
+            uint64_t last = logAppended;
+            FILE *file = logFile;
+            guard.unlock();
+            bool written = fwrite(batch.data(), 1, batch.size(), file) == batch.size() && syncFile(file);
+            guard.lock();
+            logFlushing = false;
+            if (written) {
+                logCommitted = last;
+            } else {
+                logFailed = true;
+                cout << "Could not write log " << logPath << "; changes are not being logged" << endl;
+            }
+            logFlushed.notify_all();
+        }
+        return record < logLostFrom || record > logLostTo;
+    }
+
+    void commitOrWarn(uint64_t record, const string &city1, const string &city2) {
+        if (!waitForCommit(record)) {
+            cout << "Warning: change between " << city1 << " and " << city2 << " was not written to the log" << endl;
+        }
+    }
+
+    // Caller holds logMutex through guard. Waits out any batch in flight,
+    // then writes and syncs whatever is still queued.
+    bool drainLogLocked(unique_lock<mutex> &guard) {
+        logFlushed.wait(guard, [&] { return !logFlushing; });
+        bool written = !logFailed;
+        if (written && logFile != nullptr && !logBuffer.empty()) {
+            written = fwrite(logBuffer.data(), 1, logBuffer.size(), logFile) == logBuffer.size() && syncFile(logFile);
+            logFailed = !written;
+        }
+        logBuffer.clear();
+        if (written) logCommitted = logAppended;
+        logFlushed.notify_all();
+        return written;
+    }
+
+    // Caller holds snapshotMutex and adjLock exclusively.
+    bool openLogLocked(const string &path) {
+        unique_lock<mutex> guard(logMutex);
+        if (!drainLogLocked(guard)) {
+            logLostFrom = logCommitted + 1;
+            logLostTo = logAppended;
+        }
+        if (logFile != nullptr) fclose(logFile);
+        logPath = path;
+        logFile = fopen(logPath.c_str(), "ab");
+        logFailed = logFile == nullptr;
+        logCommitted = logAppended;
+        for (const auto &segment : logSegments(logPath)) {
+            snapshotEpoch = max(snapshotEpoch, segment.first);
+        }
+        if (logFile != nullptr) syncDirectory(logPath);
+        return logFile != nullptr;
+    }
+
+    // Caller holds adjLock exclusively. epoch is set from a LogEpoch record,
+    // and validBytes to the end of the last complete record. Returns the
+    // number of changes applied.
+    size_t replayFile(const string &path, uint32_t &epoch, streamoff &validBytes) {
+        ifstream in(path, ios::binary);
+        char op;
+        string city1, city2;
+        int distance;
+        size_t count = 0;
+        validBytes = 0;
+        while (readRecord(in, op, city1, city2, distance)) {
+            if (op < LogAdd || op > LogCity) break;
+            validBytes = in.tellg();
+            if (op == LogEpoch) {
+                epoch = static_cast<uint32_t>(distance);
+                continue;
+            }
+            switch (op) {
+                case LogAdd: applyAdd(city1, city2, distance); break;
+                case LogRemove: applyRemove(city1, city2); break;
+                case LogUpdate: applyUpdate(city1, city2, distance); break;
+                case LogClear: adjList.clear(); break;
+                case LogCity: adjList[city1]; break;
+            }
+            ++count;
+        }
+        return count;
+    }
+
+    static bool stopRequested(const atomic<bool> *cancel, Deadline deadline, RouteResult &result) {
+        if (cancel != nullptr && cancel->load(memory_order_relaxed)) {
+            result.status = RouteResult::Cancelled;
+            return true;
+        }
+        if (deadline != Deadline::max() && chrono::steady_clock::now() >= deadline) {
+            result.status = RouteResult::TimedOut;
+            return true;
+        }
+        return false;
+    }
+
+    RouteResult runShortestPath(SearchWorkspace &ws, const string &start, const string &destination,
+                                const atomic<bool> *cancel, Deadline deadline) const {
+        RouteResult result;
+        if (adjList.find(start) == adjList.end() || adjList.find(destination) == adjList.end()) {
+            return result;
+        }
+
+        ws.distances.clear();
+        ws.previous.clear();
+        ws.heap.clear();
+        auto byDistance = greater<pair<int, string>>();
+
+        ws.distances[start] = 0;
+        ws.heap.push_back({0, start});
+        size_t settled = 0;
+
+        while (!ws.heap.empty()) {
+            // Checking the clock on every pop would dominate small searches.
+            if ((settled++ & 255) == 0 && stopRequested(cancel, deadline, result)) {
+                return result;
+            }
+
+            pop_heap(ws.heap.begin(), ws.heap.end(), byDistance);
+            auto [currentDist, currentCity] = move(ws.heap.back());
+            ws.heap.pop_back();
+
+            if (currentDist > ws.distances[currentCity]) continue;
+            if (currentCity == destination) break;
+
+            for (const auto &[neighbor, weight] : adjList.find(currentCity)->second) {
+                int newDist = currentDist + weight;
+                auto it = ws.distances.find(neighbor);
+                if (it == ws.distances.end() || newDist < it->second) {
+                    ws.distances[neighbor] = newDist;
+                    ws.previous[neighbor] = currentCity;
+                    ws.heap.push_back({newDist, neighbor});
+                    push_heap(ws.heap.begin(), ws.heap.end(), byDistance);
+                }
+            }
+        }
+
+        auto found = ws.distances.find(destination);
+        if (found == ws.distances.end()) {
+            return result;
+        }
+
+        for (string at = destination; at != start; at = ws.previous[at]) {
+            result.path.push_back(at);
+        }
+        result.path.push_back(start);
+        reverse(result.path.begin(), result.path.end());
+        result.distance = found->second;
+        result.status = RouteResult::Found;
+        return result;
+    }
 };
 
 int main() {
     CityGraph graph;
+    QueryPool pool;
+    HubLabels labels;
 
     // Example connections for Gondar
     graph.addConnection("Fasil Ghebbi", "Gondar Castle", 2);
@@ -270,7 +1278,14 @@ int main() {
         cout << "11. Find Isolated Cities\n";
         cout << "12. BFS Traversal\n";
         cout << "13. DFS Traversal\n";
-        cout << "14. Exit\n";
+        cout << "14. Batch Shortest Paths\n";
+        cout << "15. Enable Change Log\n";
+        cout << "16. Take Snapshot\n";
+        cout << "17. Recover from Snapshot and Log\n";
+        cout << "18. Build Distance Labels\n";
+        cout << "19. Load Distance Labels\n";
+        cout << "20. Look Up Distance\n";
+        cout << "21. Exit\n";
         cout << "Enter your choice: ";
         cin >> choice;
 
@@ -382,13 +1397,108 @@ int main() {
                 break;
 
             case 14:
+                {
+                    int count, timeLimit;
+                    cout << "Enter number of queries: ";
+                    cin >> count;
+                    cout << "Enter time limit in milliseconds: ";
+                    cin >> timeLimit;
+                    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeLimit);
+                    vector<pair<string, string>> queries;
+                    vector<future<CityGraph::RouteResult>> results;
+                    for (int i = 0; i < count; ++i) {
+                        cout << "Enter start and destination city: ";
+                        cin >> city1 >> city2;
+                        queries.push_back({city1, city2});
+                    }
+                    for (const auto &q : queries) {
+                        results.push_back(graph.submitShortestPath(pool, q.first, q.second, nullptr, deadline));
+                    }
+                    for (size_t i = 0; i < results.size(); ++i) {
+                        CityGraph::RouteResult route = results[i].get();
+                        cout << queries[i].first << " -> " << queries[i].second << ": ";
+                        switch (route.status) {
+                            case CityGraph::RouteResult::Found:
+                                for (const auto &city : route.path) {
+                                    cout << city << " ";
+                                }
+                                cout << "(" << route.distance << " km)" << endl;
+                                break;
+                            case CityGraph::RouteResult::NoPath:
+                                cout << "no path" << endl;
+                                break;
+                            case CityGraph::RouteResult::Cancelled:
+                                cout << "cancelled" << endl;
+                                break;
+                            case CityGraph::RouteResult::TimedOut:
+                                cout << "timed out" << endl;
+                                break;
+                        }
+                    }
+                }
+                break;
+
+            case 15:
+                cout << "Enter log filename: ";
+                cin >> filename;
+                graph.enableMutationLog(filename);
+                break;
+
+            case 16:
+                cout << "Enter snapshot filename: ";
+                cin >> filename;
+                graph.takeSnapshot(filename);
+                break;
+
+            case 17:
+                cout << "Enter snapshot filename: ";
+                cin >> filename;
+                cout << "Enter log filename: ";
+                cin >> city1;
+                graph.recover(filename, city1);
+                break;
+
+            case 18:
+                cout << "Enter labels filename: ";
+                cin >> filename;
+                graph.buildHubLabels(filename);
+                break;
+
+            case 19:
+                cout << "Enter labels filename: ";
+                cin >> filename;
+                if (labels.load(filename)) {
+                    labels.printStatistics();
+                } else {
+                    cout << "Could not load distance labels from " << filename << endl;
+                }
+                break;
+
+            case 20:
+                if (!labels.loaded()) {
+                    cout << "Load distance labels first." << endl;
+                    break;
+                }
+                cout << "Enter first city: ";
+                cin >> city1;
+                cout << "Enter second city: ";
+                cin >> city2;
+                distance = labels.distance(city1, city2);
+                if (distance == numeric_limits<int>::max()) {
+                    cout << "No path found from " << city1 << " to " << city2 << endl;
+                } else {
+                    cout << "Distance: " << distance << " km" << endl;
+                }
+                break;
+
+            case 21:
                 cout << "Exiting...\n";
                 break;
 
             default:
                 cout << "Invalid choice, please try again.\n";
         }
-    } while (choice != 14);
+    } while (choice != 21);
 
     return 0;
 }